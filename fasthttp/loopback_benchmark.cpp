@@ -0,0 +1,240 @@
+// End-to-end benchmark on loopback: an embedded HTTP/1.1 server (optionally
+// TLS) on 127.0.0.1 driven by the real HttpClient. No network access needed.
+//
+// Build: g++ -std=c++14 -O2 -o loopback_benchmark loopback_benchmark.cpp -lssl -lcrypto -pthread
+// Run:   ./loopback_benchmark [--concurrency=N] [--requests=N] [--payload=BYTES]
+//                             [--body=BYTES] [--no-keepalive] [--tls]
+//
+// --payload sets the response body size, --body sends POSTs with a request
+// body of that size. Reports throughput, latency percentiles and CPU time
+// per request, both for the client threads and for the whole process
+// (client plus embedded server).
+
+#include "loopback_server.hpp"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+#ifndef _WIN32
+    #include <sys/resource.h>
+#endif
+
+namespace {
+
+struct Options {
+    size_t concurrency;
+    size_t requests;
+    size_t warmup;
+    size_t payload;
+    size_t body;
+    bool keepAlive;
+    bool tls;
+
+    Options() : concurrency(16), requests(100000), warmup(1000), payload(1024), body(0), keepAlive(true), tls(false) {}
+};
+
+double threadCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user);
+    auto seconds = [](const FILETIME& t) {
+        return ((static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+#endif
+}
+
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+    auto seconds = [](const FILETIME& t) {
+        return ((static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 1e7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+std::string makeResponse(size_t size, bool close) {
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nContent-Length: " +
+                           std::to_string(size) + "\r\n";
+    if (close) response += "Connection: close\r\n";
+    response += "\r\n";
+    response.append(size, 'x');
+    return response;
+}
+
+// Every request gets a 200 with a body of `payload` bytes (or n bytes for
+// /bytes/<n>); request bodies are discarded. The server writes each
+// response in one call with TCP_NODELAY set, so latency reflects the
+// client rather than Nagle's algorithm.
+loopback::Handler payloadHandler(size_t payload) {
+    std::string response = makeResponse(payload, false);
+    std::string closingResponse = makeResponse(payload, true);
+    return [response, closingResponse](const loopback::Request& request) {
+        bool close = fasthttp::toLower(request.header("Connection")).find("close") != std::string::npos;
+        if (request.target.compare(0, 7, "/bytes/") == 0) {
+            return loopback::Response(makeResponse(std::strtoul(request.target.c_str() + 7, nullptr, 10), close));
+        }
+        return loopback::Response(close ? closingResponse : response);
+    };
+}
+
+size_t parseSize(const std::string& arg, size_t prefix) {
+    return static_cast<size_t>(std::strtoull(arg.c_str() + prefix, nullptr, 10));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 14, "--concurrency=") == 0) options.concurrency = std::max<size_t>(parseSize(arg, 14), 1);
+        else if (arg.compare(0, 11, "--requests=") == 0) options.requests = parseSize(arg, 11);
+        else if (arg.compare(0, 9, "--warmup=") == 0) options.warmup = parseSize(arg, 9);
+        else if (arg.compare(0, 10, "--payload=") == 0) options.payload = parseSize(arg, 10);
+        else if (arg.compare(0, 7, "--body=") == 0) options.body = parseSize(arg, 7);
+        else if (arg == "--no-keepalive") options.keepAlive = false;
+        else if (arg == "--tls") options.tls = true;
+        else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return 2;
+        }
+    }
+#ifdef _WIN32
+    if (options.tls) {
+        std::cerr << "--tls needs OpenSSL and is not available on Windows" << std::endl;
+        return 2;
+    }
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+    // The server writes with write(2) under OpenSSL; a client that went away
+    // must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    std::string certificatePath;
+    std::unique_ptr<loopback::Server> server;
+#ifndef _WIN32
+    if (options.tls) {
+        SSL_CTX* tls = loopback::makeTlsContext(certificatePath);
+        setenv("SSL_CERT_FILE", certificatePath.c_str(), 1);
+        server.reset(new loopback::Server(payloadHandler(options.payload), tls));
+    }
+#endif
+    if (!server) server.reset(new loopback::Server(payloadHandler(options.payload)));
+
+    fasthttp::HttpClient client;
+    fasthttp::ConnectionPoolOptions pool;
+    pool.maxIdlePerOrigin = std::max<size_t>(pool.maxIdlePerOrigin, options.concurrency);
+    client.setConnectionPoolOptions(pool);
+
+    std::string url = server->url("/");
+    fasthttp::HttpRequest request(options.body > 0 ? fasthttp::Method::POST : fasthttp::Method::GET, url);
+    if (options.body > 0) request.setBody(std::string(options.body, 'y'));
+    if (!options.keepAlive) request.setHeader("Connection", "close");
+
+    // Each worker takes request numbers from a shared counter; the first
+    // `warmup` are not measured
+    std::atomic<size_t> next(0);
+    std::atomic<unsigned long long> errors(0);
+    std::atomic<unsigned long long> reused(0);
+    std::atomic<unsigned long long> resumed(0);
+    size_t total = options.warmup + options.requests;
+    std::vector<fasthttp::LatencyHistogram> latencies(options.concurrency);
+    std::vector<double> clientCpu(options.concurrency, 0);
+    std::atomic<size_t> warmedUp(0);
+    std::chrono::steady_clock::time_point measureStart;
+    double processCpuStart = 0;
+    std::mutex startMutex;
+
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < options.concurrency; ++w) {
+        workers.emplace_back([&, w]() {
+            double cpu = 0;
+            for (;;) {
+                size_t n = next.fetch_add(1);
+                if (n >= total) break;
+                if (n == options.warmup) {
+                    // Wait for the warm-up requests still in flight before starting the clock
+                    while (warmedUp.load() < options.warmup) std::this_thread::yield();
+                    std::lock_guard<std::mutex> lock(startMutex);
+                    measureStart = std::chrono::steady_clock::now();
+                    processCpuStart = processCpuSeconds();
+                }
+                bool measured = n >= options.warmup;
+                double cpuBefore = measured ? threadCpuSeconds() : 0;
+                auto start = std::chrono::steady_clock::now();
+                try {
+                    fasthttp::HttpResponse response = client.execute(request);
+                    if (response.getStatusCode() != 200 || response.getBody().size() != options.payload) ++errors;
+                    if (n >= options.warmup && response.getTiming().connectionReused) ++reused;
+                    if (n >= options.warmup && response.getTiming().tlsResumed) ++resumed;
+                } catch (const fasthttp::HttpException&) {
+                    ++errors;
+                }
+                if (measured) {
+                    auto elapsed = std::chrono::steady_clock::now() - start;
+                    latencies[w].record(static_cast<unsigned long long>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+                    cpu += threadCpuSeconds() - cpuBefore;
+                } else {
+                    ++warmedUp;
+                }
+            }
+            clientCpu[w] = cpu;
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureStart).count();
+    double processCpu = processCpuSeconds() - processCpuStart;
+
+    fasthttp::LatencyHistogram latency;
+    double totalClientCpu = 0;
+    for (size_t w = 0; w < options.concurrency; ++w) {
+        latency.merge(latencies[w]);
+        totalClientCpu += clientCpu[w];
+    }
+    unsigned long long completed = latency.count();
+    server.reset();
+#ifndef _WIN32
+    if (!certificatePath.empty()) std::remove(certificatePath.c_str());
+#endif
+    if (completed == 0) {
+        std::cerr << "No requests measured" << std::endl;
+        return 1;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << (options.tls ? "https" : "http") << ", concurrency " << options.concurrency << ", payload "
+              << options.payload << " B, request body " << options.body << " B, keep-alive "
+              << (options.keepAlive ? "on" : "off") << std::endl;
+    std::cout << "requests      " << completed << " (" << errors.load() << " errors)" << std::endl;
+    std::cout << "connections   " << completed - reused.load() << " new, " << reused.load() << " reused";
+    if (options.tls) std::cout << ", " << resumed.load() << " TLS resumed";
+    std::cout << std::endl;
+    std::cout << "throughput    " << completed / seconds << " req/s, "
+              << completed * static_cast<double>(options.payload + options.body) / seconds / (1024 * 1024) << " MiB/s"
+              << std::endl;
+    std::cout << std::setprecision(3);
+    std::cout << "latency ms    p50 " << latency.percentileMs(0.5) << "  p99 " << latency.percentileMs(0.99)
+              << "  p999 " << latency.percentileMs(0.999) << "  max " << latency.maxMs() << "  mean "
+              << latency.meanMs() << std::endl;
+    std::cout << std::setprecision(1);
+    std::cout << "cpu us/req    client " << totalClientCpu * 1e6 / completed << "  process (client + server) "
+              << processCpu * 1e6 / completed << std::endl;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    return errors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,414 @@
+// Embedded HTTP/1.1 server on 127.0.0.1, optionally over TLS, shared by the
+// loopback tests and benchmarks. Not part of the library.
+//
+// One thread per connection. A handler maps each request to the raw bytes
+// written back; it can ask for the connection to be closed afterwards, or
+// turned into a tunnel to another loopback port, which is enough to stand
+// in for a forwarding or CONNECT proxy.
+
+#ifndef FASTHTTP_LOOPBACK_SERVER_HPP
+#define FASTHTTP_LOOPBACK_SERVER_HPP
+
+#include "fasthttp.hpp"
+#include <cctype>
+
+#ifndef _WIN32
+    #include <openssl/pem.h>
+    #include <openssl/x509v3.h>
+#endif
+
+namespace loopback {
+
+#ifdef _WIN32
+typedef SOCKET SocketHandle;
+const SocketHandle invalidSocket = INVALID_SOCKET;
+inline void closeSocket(SocketHandle socket) { closesocket(socket); }
+inline void shutdownSocket(SocketHandle socket) { shutdown(socket, SD_BOTH); }
+#else
+typedef int SocketHandle;
+const SocketHandle invalidSocket = -1;
+inline void closeSocket(SocketHandle socket) { ::close(socket); }
+inline void shutdownSocket(SocketHandle socket) { ::shutdown(socket, SHUT_RDWR); }
+#endif
+
+struct Request {
+    std::string method;
+    std::string target;
+    std::string head;  // request line and header fields, CRLF-separated
+    std::string body;
+
+    // Value of the first header field called `name`, matched case-insensitively
+    std::string header(const std::string& name) const {
+        size_t lineStart = head.find("\r\n");
+        while (lineStart != std::string::npos) {
+            lineStart += 2;
+            size_t lineEnd = std::min(head.find("\r\n", lineStart), head.size());
+            size_t colon = lineStart + name.size();
+            if (colon < lineEnd && head[colon] == ':') {
+                bool match = true;
+                for (size_t i = 0; i < name.size() && match; ++i) {
+                    match = std::tolower(static_cast<unsigned char>(head[lineStart + i])) ==
+                            std::tolower(static_cast<unsigned char>(name[i]));
+                }
+                if (match) return fasthttp::trim(head.substr(colon + 1, lineEnd - colon - 1));
+            }
+            lineStart = lineEnd == head.size() ? std::string::npos : lineEnd;
+        }
+        return "";
+    }
+};
+
+struct Response {
+    std::string data;  // written back verbatim
+    bool close;        // close the connection once written
+    int tunnelPort;    // when > 0, relay the connection to this loopback port once written
+
+    Response(std::string data = std::string(), bool close = false)
+        : data(std::move(data)), close(close), tunnelPort(0) {}
+};
+
+typedef std::function<Response(const Request&)> Handler;
+
+// A complete response with Content-Length; `extraHeaders` are CRLF-terminated lines
+inline std::string response(int status, const std::string& reason, const std::string& body,
+                            const std::string& extraHeaders = "") {
+    return "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n" + extraHeaders +
+           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+#ifndef _WIN32
+// Server context with a fresh self-signed certificate for localhost. The
+// certificate is written to a temporary PEM file, which the caller points
+// the client at through SSL_CERT_FILE and removes afterwards.
+inline SSL_CTX* makeTlsContext(std::string& certificatePath) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    EVP_PKEY_keygen_init(keyContext);
+    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1);
+    EVP_PKEY_keygen(keyContext, &key);
+    EVP_PKEY_CTX_free(keyContext);
+
+    X509* certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), 1);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -3600);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 86400);
+    X509_set_pubkey(certificate, key);
+    X509_NAME* name = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(certificate, name);
+    X509V3_CTX extensionContext;
+    X509V3_set_ctx(&extensionContext, certificate, certificate, nullptr, nullptr, 0);
+    X509_EXTENSION* altName = X509V3_EXT_conf_nid(nullptr, &extensionContext, NID_subject_alt_name,
+                                                   const_cast<char*>("DNS:localhost"));
+    X509_add_ext(certificate, altName, -1);
+    X509_EXTENSION_free(altName);
+    X509_sign(certificate, key, EVP_sha256());
+
+    char path[] = "/tmp/fasthttp-loopback-XXXXXX";
+    int fd = mkstemp(path);
+    FILE* file = fdopen(fd, "w");
+    PEM_write_X509(file, certificate);
+    fclose(file);
+    certificatePath = path;
+
+    SSL_CTX* context = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(context, certificate);
+    SSL_CTX_use_PrivateKey(context, key);
+    X509_free(certificate);
+    EVP_PKEY_free(key);
+    return context;
+}
+#endif
+
+class Server {
+private:
+    Handler handler_;
+    SocketHandle listener_;
+    int port_;
+    std::thread acceptor_;
+    std::atomic<unsigned long long> accepted_;
+    std::atomic<bool> stopping_;
+    std::mutex mutex_;
+#ifndef _WIN32
+    SSL_CTX* tls_;
+#endif
+
+    // One per accepted connection. The sockets are closed when the worker
+    // finishes; finished workers are joined by the accept loop.
+    struct Worker {
+        std::thread thread;
+        SocketHandle socket;
+        SocketHandle upstream;  // the other end of a tunnel
+        bool done;
+    };
+    std::list<Worker> workers_;  // guarded by mutex_
+
+    struct Stream {
+        SocketHandle socket;
+#ifndef _WIN32
+        SSL* ssl;
+#endif
+
+        int read(char* buffer, int size) {
+#ifndef _WIN32
+            if (ssl) return SSL_read(ssl, buffer, size);
+#endif
+            return static_cast<int>(recv(socket, buffer, size, 0));
+        }
+
+        bool writeAll(const char* data, size_t size) {
+            size_t sent = 0;
+            while (sent < size) {
+                int chunk = static_cast<int>(std::min<size_t>(size - sent, 1 << 20));
+                int n;
+#ifndef _WIN32
+                if (ssl) n = SSL_write(ssl, data + sent, chunk);
+                else
+#endif
+                n = static_cast<int>(send(socket, data + sent, chunk, 0));
+                if (n <= 0) return false;
+                sent += static_cast<size_t>(n);
+            }
+            return true;
+        }
+    };
+
+    static SocketHandle connectTo(int port) {
+        SocketHandle socket = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (socket == invalidSocket) return socket;
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(static_cast<unsigned short>(port));
+        if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+            closeSocket(socket);
+            return invalidSocket;
+        }
+        return socket;
+    }
+
+    // Copy bytes both ways until either side closes
+    void relay(Worker& worker, Stream& client, const std::string& pending, int port) {
+        SocketHandle upstream = connectTo(port);
+        if (upstream == invalidSocket) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            worker.upstream = upstream;
+        }
+        Stream origin;
+        origin.socket = upstream;
+#ifndef _WIN32
+        origin.ssl = nullptr;
+#endif
+        std::thread back([&]() {
+            std::vector<char> chunk(64 * 1024);
+            int n;
+            while ((n = origin.read(chunk.data(), static_cast<int>(chunk.size()))) > 0 &&
+                   client.writeAll(chunk.data(), static_cast<size_t>(n))) {}
+            shutdownSocket(client.socket);
+        });
+        std::vector<char> chunk(64 * 1024);
+        int n;
+        if (pending.empty() || origin.writeAll(pending.data(), pending.size())) {
+            while ((n = client.read(chunk.data(), static_cast<int>(chunk.size()))) > 0 &&
+                   origin.writeAll(chunk.data(), static_cast<size_t>(n))) {}
+        }
+        shutdownSocket(upstream);
+        back.join();
+    }
+
+    void serve(Worker& worker) {
+        int noDelay = 1;
+        setsockopt(worker.socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+                   sizeof(noDelay));
+        Stream stream;
+        stream.socket = worker.socket;
+#ifndef _WIN32
+        stream.ssl = nullptr;
+        if (tls_) {
+            stream.ssl = SSL_new(tls_);
+            SSL_set_fd(stream.ssl, worker.socket);
+            if (SSL_accept(stream.ssl) != 1) {
+                SSL_free(stream.ssl);
+                return;
+            }
+        }
+#endif
+        std::string buffer;
+        std::vector<char> chunk(64 * 1024);
+        bool open = true;
+        while (open && !stopping_) {
+            size_t headEnd;
+            while ((headEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+                int n = stream.read(chunk.data(), static_cast<int>(chunk.size()));
+                if (n <= 0) {
+                    open = false;
+                    break;
+                }
+                buffer.append(chunk.data(), static_cast<size_t>(n));
+            }
+            if (!open) break;
+
+            Request request;
+            request.head = buffer.substr(0, headEnd);
+            size_t methodEnd = request.head.find(' ');
+            size_t targetEnd = request.head.find(' ', methodEnd + 1);
+            request.method = request.head.substr(0, methodEnd);
+            request.target = request.head.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+            size_t contentLength = std::strtoul(request.header("Content-Length").c_str(), nullptr, 10);
+            size_t requestEnd = headEnd + 4 + contentLength;
+            while (buffer.size() < requestEnd) {
+                int n = stream.read(chunk.data(), static_cast<int>(chunk.size()));
+                if (n <= 0) {
+                    open = false;
+                    break;
+                }
+                buffer.append(chunk.data(), static_cast<size_t>(n));
+            }
+            if (!open) break;
+            request.body = buffer.substr(headEnd + 4, contentLength);
+            buffer.erase(0, requestEnd);
+
+            Response response = handler_(request);
+            bool written = stream.writeAll(response.data.data(), response.data.size());
+            if (written && response.tunnelPort > 0) {
+                relay(worker, stream, buffer, response.tunnelPort);
+                break;
+            }
+            bool close = response.close ||
+                         fasthttp::toLower(request.header("Connection")).find("close") != std::string::npos;
+            open = written && !close;
+        }
+#ifndef _WIN32
+        if (stream.ssl) {
+            SSL_shutdown(stream.ssl);
+            SSL_free(stream.ssl);
+        }
+#endif
+    }
+
+    void finish(Worker& worker) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closeSocket(worker.socket);
+        if (worker.upstream != invalidSocket) closeSocket(worker.upstream);
+        worker.socket = invalidSocket;
+        worker.upstream = invalidSocket;
+        worker.done = true;
+    }
+
+    void acceptLoop() {
+        while (!stopping_) {
+            SocketHandle socket = accept(listener_, nullptr, nullptr);
+            if (socket == invalidSocket) {
+                // Out of descriptors or a transient error: back off instead of spinning
+                if (!stopping_) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                continue;
+            }
+            ++accepted_;
+            std::list<Worker> finished;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopping_) {
+                    closeSocket(socket);
+                    break;
+                }
+                for (auto it = workers_.begin(); it != workers_.end();) {
+                    auto current = it++;
+                    if (current->done) finished.splice(finished.end(), workers_, current);
+                }
+                workers_.emplace_back();
+                Worker* worker = &workers_.back();
+                worker->socket = socket;
+                worker->upstream = invalidSocket;
+                worker->done = false;
+                worker->thread = std::thread([this, worker]() {
+                    serve(*worker);
+                    finish(*worker);
+                });
+            }
+            for (auto& worker : finished) worker.thread.join();
+        }
+    }
+
+    void start() {
+        listener_ = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if (bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            listen(listener_, 1024) != 0 ||
+            getsockname(listener_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            throw std::runtime_error("Failed to listen on 127.0.0.1");
+        }
+        port_ = ntohs(address.sin_port);
+        acceptor_ = std::thread([this]() { acceptLoop(); });
+    }
+
+public:
+    explicit Server(Handler handler)
+        : handler_(std::move(handler)), listener_(invalidSocket), port_(0), accepted_(0), stopping_(false) {
+#ifndef _WIN32
+        tls_ = nullptr;
+#endif
+        start();
+    }
+
+#ifndef _WIN32
+    // Serve over TLS with `tls`, which the server takes ownership of
+    Server(Handler handler, SSL_CTX* tls)
+        : handler_(std::move(handler)), listener_(invalidSocket), port_(0), accepted_(0), stopping_(false),
+          tls_(tls) {
+        start();
+    }
+#endif
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        stopping_ = true;
+#ifdef _WIN32
+        closeSocket(listener_);
+#else
+        shutdownSocket(listener_);
+#endif
+        acceptor_.join();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& worker : workers_) {
+                if (worker.socket != invalidSocket) shutdownSocket(worker.socket);
+                if (worker.upstream != invalidSocket) shutdownSocket(worker.upstream);
+            }
+        }
+        for (auto& worker : workers_) worker.thread.join();
+#ifndef _WIN32
+        closeSocket(listener_);
+        if (tls_) SSL_CTX_free(tls_);
+#endif
+    }
+
+    int port() const { return port_; }
+
+    // Connections accepted so far
+    unsigned long long connections() const { return accepted_.load(); }
+
+    // URL for `path` on this server; TLS servers are addressed as localhost
+    // to match their certificate
+    std::string url(const std::string& path) const {
+#ifndef _WIN32
+        if (tls_) return "https://localhost:" + std::to_string(port_) + path;
+#endif
+        return "http://127.0.0.1:" + std::to_string(port_) + path;
+    }
+};
+
+} // namespace loopback
+
+#endif // FASTHTTP_LOOPBACK_SERVER_HPP
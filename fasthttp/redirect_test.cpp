@@ -0,0 +1,143 @@
+// Redirect tests: credentials on cross-origin hops, against two origins on
+// 127.0.0.1 (different ports are different origins). No network access needed.
+//
+// Build: g++ -std=c++14 -O2 -o redirect_test redirect_test.cpp -lssl -lcrypto -pthread
+// Run:   ./redirect_test   (exit status 0 when every check holds)
+
+#include "loopback_server.hpp"
+#include <iostream>
+#include <cstdlib>
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (!ok) {
+        ++failures;
+        std::cout << "  FAIL: " << what << std::endl;
+    }
+}
+
+// Origin that remembers every request. /to/<url> answers 302 to <url>,
+// /moved/<url> answers 301 to <url>, anything else 200 with the target.
+class Origin {
+private:
+    mutable std::mutex mutex_;
+    std::vector<loopback::Request> seen_;
+
+    loopback::Response handle(const loopback::Request& request) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            seen_.push_back(request);
+        }
+        for (const auto& redirect : {std::make_pair(std::string("/to/"), 302),
+                                     std::make_pair(std::string("/moved/"), 301)}) {
+            if (request.target.compare(0, redirect.first.size(), redirect.first) == 0) {
+                std::string location = request.target.substr(redirect.first.size());
+                return loopback::Response(loopback::response(redirect.second, "Redirect", "",
+                                                             "Location: " + location + "\r\n"));
+            }
+        }
+        return loopback::Response(loopback::response(200, "OK", request.target));
+    }
+
+public:
+    loopback::Server server;
+
+    Origin() : server([this](const loopback::Request& request) { return handle(request); }) {}
+
+    // The last request for `target`; empty when there was none
+    loopback::Request last(const std::string& target) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = seen_.rbegin(); it != seen_.rend(); ++it) {
+            if (it->target == target) return *it;
+        }
+        return loopback::Request();
+    }
+
+    size_t count(const std::string& target) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t n = 0;
+        for (const auto& request : seen_) n += request.target == target ? 1 : 0;
+        return n;
+    }
+};
+
+// A default Authorization goes to the first origin only; other defaults
+// follow the redirect
+void testDefaultCredentialsStayBehind(Origin& first, Origin& second) {
+    fasthttp::HttpClient client;
+    client.enableRedirects();
+    client.setDefaultHeader("Authorization", "Bearer secret");
+    client.setDefaultHeader("X-Trace", "abc");
+    std::string start = "/to/" + second.server.url("/default");
+    fasthttp::HttpResponse response = client.get(first.server.url(start));
+    loopback::Request origin = first.last(start);
+    loopback::Request hop = second.last("/default");
+    std::cout << "default header: " << response.getStatusCode() << ", first origin '"
+              << origin.header("Authorization") << "', second origin '" << hop.header("Authorization") << "'"
+              << std::endl;
+    check(response.getStatusCode() == 200 && response.getBody() == "/default", "default redirect response");
+    check(origin.header("Authorization") == "Bearer secret", "first origin lost the default Authorization");
+    check(!hop.method.empty(), "second origin not reached");
+    check(hop.header("Authorization").empty(), "default Authorization reached the second origin");
+    check(hop.header("X-Trace") == "abc", "non-sensitive default dropped on the hop");
+}
+
+// The same for Authorization set on the request, over a fresh connection
+// and through the 301 cache
+void testRequestCredentialsStayBehind(Origin& first, Origin& second) {
+    fasthttp::HttpClient client;
+    client.enableRedirects();
+    std::string start = "/moved/" + second.server.url("/request");
+    fasthttp::HttpRequest request = fasthttp::GET(first.server.url(start)).setBearerToken("secret").build();
+    fasthttp::HttpResponse response = client.execute(request);
+    fasthttp::HttpResponse cached = client.execute(request);
+    loopback::Request hop = second.last("/request");
+    std::cout << "request header: " << response.getStatusCode() << ", " << cached.getStatusCode()
+              << ", second origin '" << hop.header("Authorization") << "' (" << second.count("/request")
+              << " requests)" << std::endl;
+    check(response.getStatusCode() == 200 && cached.getStatusCode() == 200, "request redirect responses");
+    check(first.count(start) == 1, "301 target not remembered");
+    check(second.count("/request") == 2, "second origin requests " + std::to_string(second.count("/request")));
+    check(hop.header("Authorization").empty(), "request Authorization reached the second origin");
+}
+
+// A hop within the origin keeps credentials of both kinds
+void testSameOriginKeepsCredentials(Origin& first) {
+    fasthttp::HttpClient client;
+    client.enableRedirects();
+    client.setDefaultHeader("Authorization", "Bearer secret");
+    fasthttp::HttpRequest request = fasthttp::GET(first.server.url("/to/" + first.server.url("/same")))
+                                        .addHeader("X-Api-Key", "key")
+                                        .build();
+    fasthttp::HttpResponse response = client.execute(request);
+    loopback::Request hop = first.last("/same");
+    check(response.getStatusCode() == 200 && response.getBody() == "/same", "same-origin redirect response");
+    check(hop.header("Authorization") == "Bearer secret", "same-origin hop lost the default Authorization");
+    check(hop.header("X-Api-Key") == "key", "same-origin hop lost a request header");
+}
+
+} // namespace
+
+int main() {
+#ifdef _WIN32
+    WSADATA wsaData;
+    WSAStartup(MAKEWORD(2, 2), &wsaData);
+#else
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    {
+        Origin first;
+        Origin second;
+        testDefaultCredentialsStayBehind(first, second);
+        testRequestCredentialsStayBehind(first, second);
+        testSameOriginKeepsCredentials(first);
+    }
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << std::endl;
+    return failures == 0 ? 0 : 1;
+}